@@ -0,0 +1,159 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <vector>
+#include <string>
+using namespace std;
+
+#include "page.h"
+#include "buf.h"
+#include "predicate.h"
+
+// A B+-tree index maps the values of one attribute of the records of
+// a heap file (the length bytes at offset, of the given type) to the
+// records' RIDs.  It lives in a file of its own, with pages of the
+// heap file's size, read and written through the buffer manager.
+//
+// Entries are (key, RID) pairs, ordered by key and then by RID, so
+// that keys can repeat and every entry can still be found to delete.
+// Leaves hold entries and are chained left to right.  An internal
+// node holds child0 and count (separator, child) pairs; the subtree of
+// a child holds the entries from its separator up to the next one.
+// Deletes only take entries out of their leaf: nodes are never merged,
+// so a separator stays a correct bound for as long as it is there.
+
+// the header page of an index file
+struct BTreeHdrPage
+{
+  int		rootPage;	// pageNo of the root node
+  int		height;		// # levels, 1 while the root is a leaf
+  int		entryCnt;	// # entries in the index
+  int		offset;		// the attribute indexed
+  int		length;
+  Datatype	type;
+};
+
+// a node of the tree.  Entries are the key followed by the RID, and
+// in internal nodes by the child pageNo
+struct BTreeNode
+{
+  int		level;		// 0 for a leaf
+  int		count;		// # entries
+  int		next;		// leaves: the next leaf, -1 if none
+  int		child0;		// internal nodes: the leftmost child
+  char		entries[1];	// really pageSize - 4*sizeof(int) bytes
+};
+
+class BTreeIndex
+{
+  friend class IndexScan;
+
+public:
+  // make an empty index file indexName for the attribute, with pages
+  // of pageSize bytes.  BADINDEXPARM if it is malformed or its entries
+  // would not fit four to a node
+  static const Status create(const string & indexName, const int offset,
+                             const int length, const Datatype type,
+                             const int pageSize = PAGESIZE);
+
+  BTreeIndex(const string & indexName, Status& status);
+  ~BTreeIndex();
+
+  const int getOffset() const { return header->offset; }
+  const int getLength() const { return header->length; }
+  const Datatype getType() const { return header->type; }
+  const int getEntryCnt() const { return header->entryCnt; }
+  const int getHeight() const { return header->height; }
+
+  // add or remove the entry of the record at rid whose attribute is
+  // key (getLength() bytes).  NONUNIQUEENTRY if the entry is there
+  // already, RECNOTFOUND if there is none to remove
+  const Status insertEntry(const void* key, const RID & rid);
+  const Status deleteEntry(const void* key, const RID & rid);
+
+  // fill an empty index with the n entries keys[i*getLength()..],
+  // rids[i], in any order: they are sorted and packed into leaves and
+  // the levels above built from those, rather than inserted one by one
+  const Status bulkLoad(const char* keys, const RID* rids, const int n);
+
+private:
+  File*		file;
+  BTreeHdrPage*	header;		// pinned for the life of the object
+  int		headerPageNo;
+  bool		hdrDirty;
+
+  // compares keys the way the matching AttrMatch does
+  int		(*keyCompare)(const char* a, const char* b, const int length);
+
+  // a new root or sibling pushed up from a split
+  struct Split
+  {
+    vector<char>	entry;	// separator key and RID
+    int			pageNo;	// the node to its right
+  };
+
+  int entrySize(const int level) const;
+  int capacity(const int level) const;
+  char* entryAt(BTreeNode* node, const int i) const;
+  const char* entryAt(const BTreeNode* node, const int i) const;
+  int childAt(const BTreeNode* node, const int i) const;
+
+  // order of the entry at a against key and rid
+  int compare(const char* a, const char* key, const RID & rid) const;
+
+  // the first entry of node that is not below (key, rid); and in an
+  // internal node, the child whose subtree (key, rid) belongs in
+  int lowerBound(const BTreeNode* node, const char* key,
+                 const RID & rid) const;
+  int childFor(const BTreeNode* node, const char* key,
+               const RID & rid) const;
+
+  // the leaf (key, rid) belongs in, left pinned
+  const Status findLeaf(const char* key, const RID & rid, int& pageNo,
+                        BTreeNode*& leaf);
+
+  // insert entry into the subtree at pageNo, setting split.pageNo to
+  // -1, or to the new right sibling if the node had to be split
+  const Status insertAt(const int pageNo, const char* entry, Split& split);
+
+  // put bytes, an entry of node (pinned page pageNo), at pos, and
+  // unpin it; split as for insertAt
+  const Status place(const int pageNo, BTreeNode* node, const int pos,
+                     const char* bytes, Split& split);
+  const Status newNode(const int level, int& pageNo, BTreeNode*& node);
+};
+
+
+// A scan of an index for the records whose attribute value v has
+// "v op filter", with op and filter as for HeapFileScan::startScan.
+// RIDs come out in key order (in RID order for equal keys); only the
+// leaves that can hold matches are read, except for NE.  The scan
+// picks up from the last entry it returned, so entries may be added
+// and removed while it is on.
+class IndexScan
+{
+public:
+  IndexScan(const string & indexName, Status& status);
+  ~IndexScan();
+
+  // filter is the attribute's length long.  BADINDEXPARM for a NULL
+  // filter or an unknown operator
+  const Status startScan(const char* filter, const Operator op);
+
+  // the next RID, or NOMORERECS
+  const Status scanNext(RID& outRid);
+  const Status endScan();
+
+private:
+  BTreeIndex	index;
+  Operator	op;
+  vector<char>	filter;
+  AttrMatch	match;
+  bool		started;	// startScan has been called
+  int		curPageNo;	// the leaf the scan is at, -1 at the end
+  BTreeNode*	curLeaf;	// pinned while curPageNo is not -1
+  vector<char>	last;		// key and RID the scan goes on from,
+  bool		hasLast;	// if it has one (else from the leaf's start)
+};
+
+#endif
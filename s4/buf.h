@@ -1,30 +1,66 @@
 #ifndef BUF_H
 #define BUF_H
 
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
 #include "db.h"
+#include "bufPolicy.h"
+#include "ioring.h"
+#include "wal.h"
 // define if debug output wanted
 //#define DEBUGBUF
 
 // declarations for buffer pool hash table
+// One slot of the open addressing table.  Slots are 16 bytes and the
+// slot arrays are 64-byte aligned, so the key (file,pageNo) and the
+// frame number always sit in the same cache line; an empty slot has
+// file == NULL.
 struct hashBucket
 {
-	File*	file;    // pointer a file object (more on this below)
+	const File* file;    // pointer a file object (more on this below)
 	int	pageNo;  // page number within a file
 	int	frameNo; // frame number of page in the buffer pool
-	hashBucket* 	next;	 // next node in the hash table
 };
 
 
+// number of independently latched partitions of the buffer hash table
+const int HTPARTITIONS = 16;
+
 // hash table to keep track of pages in the buffer pool
+// The table is split into HTPARTITIONS independent linear probing
+// tables, selected by the top bits of the hash.  Each one is sized from
+// the number of buffers up front, with room for far more than its
+// share of the pages, so insert, lookup and remove do not allocate;
+// only if a partition still fills past 3/4 does insert double it,
+// under the latch.  insert, lookup and remove do not latch anything
+// themselves: the caller must hold the partition latch returned by
+// latchFor() for the (file,pageNo) involved, which lets BufMgr make
+// lookup-and-pin and check-and-remove atomic.
 class BufHashTbl
 {
 private:
-    int HTSIZE;
-    hashBucket**  ht; // actual hash table
-    int	 hash(const File* file, const int pageNo); // returns value between 0 and HTSIZE-1
+    struct Partition {
+      hashBucket* slot; // slotMask+1 slots
+      unsigned slotMask; // number of slots - 1 (a power of two)
+      int used;         // number of slots holding an entry
+    };
+    Partition part[HTPARTITIONS];
+    std::mutex latch[HTPARTITIONS]; // one latch per partition
+
+    // mixes (file,pageNo) so pages of one file spread over the table
+    static unsigned long hash(const File* file, const int pageNo);
+    static int partitionOf(const unsigned long h)
+    {
+      return (int) (h >> 60) % HTPARTITIONS;
+    }
+    Status grow(Partition& p); // double the slots of a full partition
 
 public:
-    BufHashTbl(const int htSize);  // constructor
+    BufHashTbl(const int htSize);  // constructor, htSize = max # entries
     ~BufHashTbl(); // destructor
 	
     // insert entry into hash table mapping (file,pageNo) to frameNo;
@@ -39,95 +75,382 @@ public:
     // delete entry (file,pageNo) from hash table. REturn OK if page was
     // found.  Else return HASHTBLERROR
   Status remove(const File* file, const int pageNo);  
+
+    // return the latch of the partition that (file,pageNo) hashes to
+  std::mutex& latchFor(const File* file, const int pageNo)
+  {
+    return latch[partitionOf(hash(file, pageNo))];
+  }
 };
 
 
 class BufMgr;  //forward declaration of BufMgr class 
+class PageGuard;
 
-// class for maintaining information about buffer pool frames
-class BufDesc {
-    friend class BufMgr;
-private:
-  File* file;   // pointer to file object
-  int   pageNo; // page within file
-  int	frameNo;  // frame # of frame
-  int   pinCnt; // number of times this page has been pinned
-  bool 	dirty;	  // true if dirty;  false otherwise
+// The state of a buffer pool frame, in two parts.  FrameState has
+// the fields looked at on every pin and by every sweep of the pool,
+// eight frames to a cache line; BufDesc the rest.  pinCnt and dirty
+// are updated by readers holding only the hash partition latch, so
+// they are atomic.  Reference information lives in the replacement
+// policy.  file, pageNo and valid change only while the frame latch
+// and the partition latch are both held.
+struct FrameState {
+  std::atomic<int>  pinCnt; // number of times this page has been pinned
+  std::atomic<bool> dirty;  // true if dirty;  false otherwise
   bool 	valid;   // true if page is valid
-  bool  refbit;	 // has this buffer frame been reference recently
+  std::atomic<bool> ioPending; // true while the page is being read in
+                              // or written out
 
   void Clear() {  // initialize buffer frame for a new user
     	pinCnt = 0;
-	file = NULL;
-	pageNo = -1;
     	dirty = false;
 	valid = false;
+	ioPending = false;
   };
 
-  void Set(File* filePtr, int pageNum) { 
-      file = filePtr;
-      pageNo = pageNum;
-      pinCnt = 1;
-      dirty = false;
-      valid = true;
-      refbit = true;
+  FrameState() {
+      Clear();
   }
+};
+
+class BufDesc {
+    friend class BufMgr;
+private:
+  File* file;   // pointer to file object
+  int   pageNo; // page within file
+  int	frameNo;  // frame # of frame
+  std::mutex latch; // held while the frame is being evicted or refilled
+  std::atomic<Lsn> lsn; // end of the update that last changed the
+                        // page, 0 if none has since it came in
+  int   prevFrame;      // neighbours on the frame list of file,
+  int   nextFrame;      // -1 at either end (see File::firstFrame)
 
   BufDesc() {
-      Clear();
+      file = NULL;
+      pageNo = -1;
+      lsn = 0;
+      prevFrame = nextFrame = -1;
   }
 };
 
 
+// a copy of the counters of BufStats, taken at one moment
+struct BufCounts
+{
+  unsigned long long accesses, diskreads, diskwrites;
+  unsigned long long hits, misses, evictions;
+  unsigned long long evictWrites, flushWrites, cleanWrites;
+  unsigned long long pinWaits, pinWaitNanos;
+};
+
 struct BufStats
 {
-  int accesses;    // Total number of accesses to buffer pool
-  int diskreads;   // Number of pages read from disk (including allocs)
-  int diskwrites;  // Number of pages written back to disk
+  typedef std::atomic<unsigned long long> Counter;
+
+  Counter accesses;    // Total number of accesses to buffer pool
+  Counter diskreads;   // Number of pages read from disk (including allocs)
+  Counter diskwrites;  // Number of pages written back to disk
+
+  // outcomes under the replacement policy named by policy
+  const char* policy;  // BufPolicy::name() of the pool
+  Counter hits;        // readPage found the page in the pool
+  Counter misses;      // readPage or allocPage needed a frame
+  Counter evictions;   // valid pages replaced to make room
+
+  // diskwrites split by who wrote the page back
+  Counter evictWrites; // allocBuf, to reuse a dirty frame
+  Counter flushWrites; // flushFile and the destructor
+  Counter cleanWrites; // the background flusher
+
+  // pins that had to wait for a read or write of the page to finish
+  Counter pinWaits;
+  Counter pinWaitNanos; // total time they waited
 
   void clear()
     {
       accesses = diskreads = diskwrites = 0;
+      hits = misses = evictions = 0;
+      evictWrites = flushWrites = cleanWrites = 0;
+      pinWaits = pinWaitNanos = 0;
+    }
+
+  BufCounts snapshot() const
+    {
+      BufCounts c;
+      c.accesses = accesses; c.diskreads = diskreads;
+      c.diskwrites = diskwrites;
+      c.hits = hits; c.misses = misses; c.evictions = evictions;
+      c.evictWrites = evictWrites; c.flushWrites = flushWrites;
+      c.cleanWrites = cleanWrites;
+      c.pinWaits = pinWaits; c.pinWaitNanos = pinWaitNanos;
+      return c;
     }
       
   BufStats()
     {
+      policy = "";
       clear();
     }
 };
 
 
+// a page read started with BufMgr::readPageAsync, as handed back by
+// BufMgr::reapPages.  If status is OK, page is pinned as by readPage.
+struct PageRead
+{
+  File* file;     // file the page belongs to
+  int   pageNo;   // page number within the file
+  long  tag;      // whatever the caller passed to readPageAsync
+  Status status;  // outcome of the read
+  Page* page;     // the page in the buffer pool, if status is OK
+};
+
+
+// Completions of one caller's asynchronous reads.  Every read started
+// on a queue must be reaped before the queue goes away.
+class ReadQueue
+{
+  friend class BufMgr;
+private:
+  std::mutex latch;           // protects the fields below
+  std::condition_variable cv; // signalled when a read completes
+  std::deque<PageRead> done;  // completed, not yet reaped
+  int pending;                // started and not yet reaped
+
+public:
+  ReadQueue() { pending = 0; }
+  int inFlight()              // # reads started and not yet reaped
+  {
+    std::lock_guard<std::mutex> lk(latch);
+    return pending;
+  }
+};
+
+
+// The buffer manager may be shared by several threads.  Lookups latch
+// only one hash partition, pins are atomic, and allocBuf claims the
+// frames its replacement policy proposes with try_lock on the frame
+// latch, so threads working on different pages do not serialize.
+// Latches are always taken in the order frame latch, then partition
+// latch.  Concurrent readers of one file are fine; the heap file layer
+// does not latch its header page, so writers must work on distinct
+// files.
 class BufMgr 
 {
 private:
-  unsigned int 	 clockHand;
+  BufPolicy*	 policy;	// picks victims for allocBuf
   int   	 numBufs;    	// Number of pages in buffer pool
+  unsigned	 frameSize;	// bytes per frame, the largest page size served
   BufHashTbl*    hashTable;  	// hash table mapping (File, page) to frame
   BufDesc*	 bufTable;  	// vector of status info, 1 per page
+  FrameState*	 bufState;	// the hot half of it, likewise
   BufStats	 bufStats;	// buffer pool statistics
 
-  const Status allocBuf(int & frame);   // allocate a free frame.  
+  std::mutex	 ioLatch;	// protects waits on FrameState::ioPending
+  std::condition_variable ioDone; // signalled when a page read completes
+
+  // allocate a free frame.  On success the frame latch is held by
+  // the caller, the frame is invalid and it is not in the hash table
+  const Status allocBuf(int & frame);
   const void releaseBuf(int frame); // return unused frame to end of list
-  void advanceClock()
-  {
-	clockHand = (clockHand + 1) % numBufs;
-  }
+  void waitForIo(const int frame); // block until frame is read in
+  // wake up waitForIo callers and finish the asynchronous reads
+  // waiting on frame, with the outcome of its read
+  void ioComplete(const int frame, const Status status = OK);
+  // make frame free, or hand it to page pageNo of file with one pin
+  void clearFrame(const int frame);
+  void setFrame(const int frame, File* file, const int pageNo);
+  // take the entry of a frame whose read failed out of the pool
+  void readFailed(const int frame);
+  // make free again a claimed frame that setFrame gave to a page the
+  // hash table then refused, waking anyone waiting on it with status.
+  // The caller holds the frame and partition latches
+  void unclaimFrame(const int frame, const Status status);
+  // add frame to, or take it off, the list of frames holding pages of
+  // its file, which lets flushFile skip the rest of the pool
+  void linkFrame(const int frame);
+  void unlinkFrame(const int frame);
+
+  // asynchronous I/O: reads and writes are submitted to ring and a
+  // reaper thread finishes them.  Without io_uring ring is NULL and
+  // everything is done synchronously.
+  struct AsyncOp;
+  struct WriteBatch;
+  IoRing*        ring;           // NULL if io_uring is not available
+  std::thread    reaper;         // waits for ring completions
+  std::atomic<int> ringOps;      // submitted and not yet completed
+  void reapLoop();               // body of the reaper thread
+  void finishRead(const int frame, PageRead read, ReadQueue* queue,
+                  const Status status);
+  void deliver(ReadQueue& queue, const PageRead& read);
+
+  // readPageAsync hits on frames still being read in; under ioLatch
+  struct IoWaiter {
+    int        frame;  // frame being read in
+    PageRead   read;   // completion to deliver
+    ReadQueue* queue;  // where to deliver it
+  };
+  std::vector<IoWaiter> ioWaiters;
+
+  // read-ahead: a background thread follows the nextPage chain of a
+  // data page and pulls the following pages into the pool.  Each file
+  // has at most one queued request; a new one replaces the old.
+  struct PrefetchReq {
+    File* file;    // file to read from
+    int   pageNo;  // page whose successors are wanted
+    int   count;   // number of successors to read
+    std::vector<int> pages; // or, if not empty, the pages to read
+  };
+  std::deque<PrefetchReq> prefetchQueue; // pending requests
+  std::mutex     prefetchLatch;  // protects the fields below
+  std::condition_variable prefetchCv; // queue changed or request done
+  std::thread    prefetcher;	 // started by the first prefetchChain
+  std::atomic<bool> stopPrefetch; // set by ~BufMgr
+  const File*    prefetchBusy;   // file of the request being worked on
+  std::atomic<const File*> prefetchCancel; // stop work on this file asap
+  void prefetchLoop();           // body of the prefetcher thread
+  const Status queuePrefetch(PrefetchReq& req); // hand req to the prefetcher
+  void cancelPrefetch(const File* file); // drop and wait out requests
+
+  // write out the dirty pages among frames, whose latches the caller
+  // holds, sorted by (file,pageNo) with runs of adjacent pages going
+  // out in one writePages call.  Clears the dirty bits.  Pages pinned
+  // by someone are skipped if skipPinned.
+  const Status writeDirty(std::vector<int>& frames,
+                          const bool skipPinned = false);
+
+  // background flusher: keeps at least cleanTarget frames clean or
+  // free so allocBuf rarely has to write a victim itself
+  std::thread    flusher;	 // started by setCleanShare
+  std::mutex     flushLatch;     // protects the fields below
+  std::condition_variable flushCv; // wakes up the flusher
+  std::atomic<int> cleanTarget;  // # clean frames wanted, 0 = off
+  bool           stopFlush;      // set to shut the flusher down
+  void flushLoop();              // body of the flusher thread
+  void cleanFrames();            // one round of background writes
+
+  // write-ahead logging, see setLog
+  LogMgr*        log;            // NULL if there is none
+  // add the change to page pageNo of file, pinned by the caller, to
+  // the update the thread has open, or log it by itself if there is
+  // none.  With unpin the caller's pin goes too
+  const Status logChange(File* file, const int pageNo, const bool unpin);
+  // log the pages the thread's update holds and let go of them, then
+  // give back the pages it disposed of
+  const Status logUpdate();
 
 
 public:
-  Page*	         bufPool;   // actual buffer pool
+  char*	         bufPool;   // actual buffer pool, numBufs frames of frameSize
+  size_t	 poolBytes;	// size of the mapping bufPool is in
+  const char*	 poolPages;	// what kind of memory pages back it
+
+  // address of the page held in frame
+  Page* framePage(const int frame) const
+  {
+    return (Page*) (bufPool + (size_t) frame * frameSize);
+  }
 
-  BufMgr(const int bufs);
+  // files whose pages are larger than pageSize cannot be read through
+  // this pool (readPage and allocPage return BADPAGESIZE)
+  BufMgr(const int bufs, const BufPolicyType policyType = CLOCK,
+         const unsigned pageSize = PAGESIZE);
   ~BufMgr();
 
   const Status readPage(File* file, const int PageNo, Page*& page);
+  // the same, with the pin held by guard
+  const Status readPage(File* file, const int PageNo, PageGuard& guard);
+  // the same if the page is in the pool; HASHNOTFOUND, and no read,
+  // if it is not
+  const Status readCachedPage(File* file, const int PageNo, Page*& page);
+
+  // start reading PageNo of file and return without waiting for the
+  // disk.  Each call that returns OK is answered by one PageRead on
+  // queue; tag is passed through.
+  const Status readPageAsync(File* file, const int PageNo, ReadQueue& queue,
+                             const long tag = 0);
+  // block until min reads on queue have completed (or all of them, if
+  // fewer are in flight), then move up to max of them to out.
+  // Returns the number moved.
+  int reapPages(ReadQueue& queue, PageRead* out, const int max,
+                const int min = 1);
   const Status unPinPage(File* file, const int PageNo, const bool dirty);
   const Status allocPage(File* file, int& PageNo, Page*& page); 
                         // allocates a new, empty page 
+  const Status allocPage(File* file, int& PageNo, PageGuard& guard);
   const Status flushFile(const File* file); // writing out all dirty pages of the file
-  const Status disposePage(File* file, const int PageNo); // dispose of page in file
+  // dispose of page in file; PAGEPINNED, and nothing done, if it is
+  // pinned by anyone
+  const Status disposePage(File* file, const int PageNo);
+  // whether anyone holds a pin on page PageNo of file besides the own
+  // pins of the caller (and that of the caller's open update)
+  const bool pinnedByOthers(File* file, const int PageNo, const int own);
+
+  // asynchronously read up to count pages that follow PageNo on
+  // its nextPage chain into the buffer pool, without pinning them
+  const Status prefetchChain(File* file, const int PageNo, const int count);
+
+  // the same for the count pages listed in pageNos, which are all
+  // read at once
+  const Status prefetchPages(File* file, const int* pageNos, const int count);
+
+  // run a background flusher that writes dirty unpinned pages to
+  // keep share (0..1) of the pool clean; 0 stops it
+  const Status setCleanShare(const double share);
   void  printSelf();
 
+  const unsigned getFrameSize() const { return frameSize; }
+
+  // Log every change to a page from now on in log (NULL to stop),
+  // which must stay until the pool goes or another is set.  A page
+  // changed from here on is written back only once the log has the
+  // change on disk.  To be called while nothing else uses the pool.
+  //
+  // Changes are logged when the page is unpinned dirty, or given to
+  // markUpdated, as an update of their own.  Between beginUpdate and
+  // endUpdate they are instead collected, each page kept pinned, and
+  // logged together at the end, so that recovery replays all of them
+  // or none.  The pages an update disposes of return to the file only
+  // once it is in the log.  An update that holds a quarter of the pool,
+  // or pages of a file that is being closed, is logged and let go of
+  // there and then, in parts.  Without a log all of these do nothing.
+  void setLog(LogMgr* log_) { log = log_; }
+  LogMgr* getLog() const { return log; }
+
+  // updates nest: only the outermost endUpdate logs
+  void beginUpdate();
+  const Status endUpdate();
+
+  // page pageNo of file, which the caller has pinned, has changed and
+  // stays pinned (a header page held for the life of a handle, say)
+  const Status markUpdated(File* file, const int pageNo);
+
+  // log the count pages in pages as pages pageNos of file, with its
+  // DB header, and wait for them to be on disk, before the caller
+  // writes them to the file itself rather than through the pool
+  const Status logWrites(File* file, const int* pageNos,
+                         Page* const* pages, const int count);
+
+  // log that fileName is destroyed, so recovery removes it
+  const Status logDestroy(const string & fileName);
+
+  // write every dirty page back, and empty the log once the files
+  // are on disk.  Waits for the updates in progress to end; it must
+  // not itself be called from inside one (BADBUFPARM)
+  const Status checkpoint();
+
+  // The pool is mapped with 1 GB or 2 MB huge pages where it is large
+  // enough and the system has them reserved (see /proc/meminfo), or
+  // else asks for transparent huge pages.  Returns "1G", "2M", "THP"
+  // or "base" accordingly.
+  const char* getPoolPages() const { return poolPages; }
+
+  // spread the frames over all NUMA nodes, page by page, rather than
+  // keeping each one on the node that first touched it (on is false);
+  // frames already in memory are moved.  UNIXERR if the kernel has no
+  // NUMA support
+  const Status setNumaInterleave(const bool on);
+
   const BufStats & getBufStats() const // get buffer pool usage
   {
 	return bufStats;
@@ -136,7 +459,91 @@ public:
   {
 	bufStats.clear();
   }
+
+  // write the pool counters, and hit ratio, to out, one per line
+  void printStats(std::ostream& out) const;
 };
 
-#endif
 
+// A pin on a page of the buffer pool that is given back when the guard
+// goes away.  A guard can be moved, handing its pin on, but not copied.
+// The page is unpinned dirty if markDirty was called.
+class PageGuard
+{
+public:
+  PageGuard() : mgr(NULL), file(NULL), pageNo(-1), page(NULL), dirty(false) {}
+
+  // take over a pin the caller got from mgr
+  PageGuard(BufMgr* mgr_, File* file_, const int pageNo_, Page* page_)
+    : mgr(mgr_), file(file_), pageNo(pageNo_), page(page_), dirty(false) {}
+
+  PageGuard(PageGuard&& other)
+    : mgr(other.mgr), file(other.file), pageNo(other.pageNo),
+      page(other.page), dirty(other.dirty)
+  {
+    other.page = NULL;
+  }
+
+  PageGuard& operator=(PageGuard&& other)
+  {
+    if (this != &other) {
+      release();
+      mgr = other.mgr;
+      file = other.file;
+      pageNo = other.pageNo;
+      page = other.page;
+      dirty = other.dirty;
+      other.page = NULL;
+    }
+    return *this;
+  }
+
+  ~PageGuard() { release(); }
+
+  Page* get() const { return page; }
+  Page* operator->() const { return page; }
+  File* getFile() const { return file; }
+  const int getPageNo() const { return pageNo; }
+  bool isPinned() const { return page != NULL; }
+  void markDirty() { dirty = true; }
+
+  // unpin the page now; OK if there is nothing pinned
+  const Status release();
+
+private:
+  BufMgr* mgr;
+  File*   file;
+  int     pageNo;
+  Page*   page;    // NULL once the pin is gone
+  bool    dirty;
+
+  PageGuard(const PageGuard&);             // not copyable
+  PageGuard& operator=(const PageGuard&);
+};
+
+
+// Brackets the page changes of one operation, so that with a log they
+// go in as one update (see BufMgr::beginUpdate).  The update ends when
+// the guard goes, unless end() was called first.
+class UpdateGuard
+{
+public:
+  UpdateGuard(BufMgr* mgr_) : mgr(mgr_), open(true) { mgr->beginUpdate(); }
+  ~UpdateGuard() { end(); }
+
+  const Status end()
+  {
+    if (!open) return OK;
+    open = false;
+    return mgr->endUpdate();
+  }
+
+private:
+  BufMgr* mgr;
+  bool    open;
+
+  UpdateGuard(const UpdateGuard&);         // not copyable
+  UpdateGuard& operator=(const UpdateGuard&);
+};
+
+#endif
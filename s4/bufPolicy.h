@@ -0,0 +1,117 @@
+#ifndef BUFPOLICY_H
+#define BUFPOLICY_H
+
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <unordered_set>
+class File;
+
+// replacement policies the buffer manager can be built with
+enum BufPolicyType { CLOCK, TWOQ };
+
+// Interface between BufMgr::allocBuf and a page replacement policy.
+// The policy only orders frames; BufMgr still decides whether a
+// candidate can really be used (invalid, or valid and unpinned) and
+// tells the policy what happened.  Implementations must be safe to
+// call from several threads and must not call back into BufMgr.
+class BufPolicy
+{
+public:
+  // per-allocation scan state, owned by the allocBuf call
+  struct Cursor {
+    int step;   // number of candidate() calls made so far
+    int phase;  // policy specific
+    int list;   // policy specific
+    int pos;    // policy specific
+  };
+
+  virtual ~BufPolicy() {}
+  virtual const char* name() const = 0;
+
+  // the page in frame was found in the pool
+  virtual void hit(const int frame) = 0;
+  // frame now holds (file,pageNo), just read in or allocated
+  virtual void loaded(const int frame, const File* file, const int pageNo) = 0;
+  // the page in frame is being replaced
+  virtual void evicted(const int frame, const File* file, const int pageNo) = 0;
+  // frame was emptied without being chosen as a victim
+  virtual void freed(const int frame) = 0;
+
+  // return the next frame allocBuf should consider, or -1 if this
+  // step produced none (e.g. the clock only cleared a reference bit)
+  virtual int candidate(Cursor& c) = 0;
+};
+
+// create the policy of the given type for a pool of numBufs frames
+BufPolicy* newBufPolicy(const BufPolicyType type, const int numBufs);
+
+
+// The classic clock: a sweeping hand and one reference bit per frame.
+// Lock free, so several allocBuf calls can sweep at once.
+class ClockPolicy : public BufPolicy
+{
+private:
+  int numBufs;
+  std::atomic<unsigned int> clockHand;
+  std::atomic<bool>* refbit; // has this frame been referenced recently
+
+public:
+  ClockPolicy(const int bufs);
+  ~ClockPolicy();
+  const char* name() const { return "clock"; }
+  void hit(const int frame) { refbit[frame] = true; }
+  void loaded(const int frame, const File*, const int) { refbit[frame] = true; }
+  void evicted(const int, const File*, const int) {}
+  void freed(const int frame) { refbit[frame] = false; }
+  int candidate(Cursor& c);
+};
+
+
+// Simplified 2Q (Johnson & Shasha).  Pages enter a FIFO (A1in) on their
+// first reference and are only promoted to the LRU list (Am) if they
+// are referenced again after falling out of A1in, which is detected with
+// a bounded queue of ghost keys (A1out).  A long sequential scan thus
+// only ever cycles through A1in and leaves hot pages in Am alone.
+// All state is protected by one latch.
+class TwoQPolicy : public BufPolicy
+{
+private:
+  enum { FREEQ, A1IN, AM };   // list a frame is on
+  struct Key {
+    const File* file;
+    int pageNo;
+    bool operator==(const Key& o) const
+      { return file == o.file && pageNo == o.pageNo; }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& k) const
+      { return (size_t) k.file * 31 + (unsigned) k.pageNo; }
+  };
+
+  int numBufs;
+  int kin;             // target size of A1in
+  int kout;            // maximum number of ghosts in A1out
+  int* prev;           // doubly linked lists threaded through frames;
+  int* next;           // head is most recent, tail is next to go
+  int* list;           // list each frame is on
+  int head[3], tail[3], size[3];
+  std::deque<Key> ghostFifo;               // A1out, oldest first
+  std::unordered_set<Key, KeyHash> ghosts; // A1out membership
+  std::mutex latch;
+
+  void unlink(const int frame);
+  void pushHead(const int l, const int frame);
+
+public:
+  TwoQPolicy(const int bufs);
+  ~TwoQPolicy();
+  const char* name() const { return "2q"; }
+  void hit(const int frame);
+  void loaded(const int frame, const File* file, const int pageNo);
+  void evicted(const int frame, const File* file, const int pageNo);
+  void freed(const int frame);
+  int candidate(Cursor& c);
+};
+
+#endif
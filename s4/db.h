@@ -3,6 +3,13 @@
 
 #include <sys/types.h>
 #include <functional>
+#include <mutex>
+#include <atomic>
+#include <list>
+#include <vector>
+#include <new>
+#include <iosfwd>
+#include <stdlib.h>
 #include "error.h"
 #include <string.h>
 using namespace std;
@@ -14,11 +21,82 @@ using namespace std;
 
 // forward class definition for db
 class DB;
+class IoRing;
+struct iovec;
+
+// buffer and transfer alignment that O_DIRECT files need
+const int DIRECTIOALIGN = 4096;
+
+// zeroed, heap allocated scratch memory for one page of a given size
+// (a plain Page object only holds a PAGESIZE page), aligned for O_DIRECT
+class PageBuf {
+ public:
+  PageBuf(const unsigned size)
+  {
+    if (posix_memalign((void**) &mem, DIRECTIOALIGN, size) != 0)
+      throw std::bad_alloc();
+    memset(mem, 0, size);
+  }
+  ~PageBuf() { free(mem); }
+  Page* page() { return (Page*) mem; }
+
+ private:
+  char* mem;
+  PageBuf(const PageBuf&);            // not copyable
+  PageBuf& operator=(const PageBuf&);
+};
+
+// A histogram of I/O latencies.  Bucket b counts the transfers that
+// took less than 2^b microseconds (and, but for bucket 0, at least
+// 2^(b-1)); the last bucket also takes everything slower.
+struct IoHistogram
+{
+  static const int BUCKETS = 24;
+  std::atomic<unsigned long long> count[BUCKETS];
+  std::atomic<unsigned long long> nanos;       // total time taken
+
+  IoHistogram() { clear(); }
+  void clear();
+  void add(const unsigned long long took);     // took is in nanoseconds
+  unsigned long long transfers() const;        // sum of the buckets
+  void print(std::ostream& out, const char* name) const;
+};
+
+// What has been done with the pages of one open file.  hits and misses
+// are counted by the buffer manager, the rest by the file itself.
+struct FileStats
+{
+  std::atomic<unsigned long long> hits;      // page found in the pool
+  std::atomic<unsigned long long> misses;    // page had to be read or made
+  std::atomic<unsigned long long> reads;     // pages read from the file
+  std::atomic<unsigned long long> writes;    // pages written to the file
+  std::atomic<unsigned long long> packed;    // of those, written compressed
+  IoHistogram readLatency;   // one entry per pread/preadv
+  IoHistogram writeLatency;  // one entry per pwrite/pwritev
+
+  FileStats() { clear(); }
+  void clear();
+  void print(std::ostream& out) const;
+};
 
 // class definition for open files
+// structure of DB (header) page
+
+typedef struct {
+  int nextFree;                         // page # of next page on free list
+  int firstPage;                        // page # of first page in file
+  int numPages;                         // total # of pages in file
+  int pageSize;                         // size of every page of the file
+  int compress;                         // pages are stored compressed
+} DBPage;
+
+// number of pages the file grows by when it runs out of room
+const int EXTENTPAGES = 32;
+
 class File {
   friend class DB;
   friend class OpenFileHashTbl;
+  friend class BufMgr;
 
  public:
 
@@ -28,7 +106,44 @@ class File {
 		  Page* pagePtr) const;       // read page from file
   const Status writePage(const int pageNo,
 		   const Page* pagePtr);      // write page to file
+  const Status readPages(const int pageNo, Page* const* pagePtrs,
+                         const int count) const; // read count consecutive
+                                                 // pages starting at pageNo
+  const Status writePages(const int pageNo, const Page* const* pagePtrs,
+                          const int count); // write count consecutive
+                                            // pages starting at pageNo
+  // queue an asynchronous read of one page, or write of a run of
+  // count pages held in iov, on ring; the result goes to the thread
+  // waiting on ring together with user
+  const Status submitRead(IoRing& ring, const int pageNo, Page* pagePtr,
+                          void* user) const;
+  const Status submitWrite(IoRing& ring, const int pageNo,
+                           const struct iovec* iov, const int count,
+                           void* user) const;
   const Status getFirstPage(int& pageNo) const;     // returns pageNo of first page
+  const Status writeHeader();                       // write back the DB header
+  const int getPageSize() const { return pageSize; } // page size of the file
+  const bool isDirectIO() const { return directIO; } // bypasses page cache
+  const bool isCompressed() const { return compress; } // see intwrite
+  FileStats& getStats() const { return stats; }      // counters, see FileStats
+
+  // Map the pages the file has now read-only, for scans that read
+  // pages where they lie instead of copying them into the buffer
+  // pool.  Maps are counted: the mapping stays until every map() has
+  // had its unmap(), or the file is closed.  The kernel is told the
+  // pages will be read in order.
+  const Status map();
+  void unmap();
+  // page pageNo as it is in the file, or NULL if it is not mapped
+  // (it was allocated after the mapping was made, say)
+  const Page* mappedPage(const int pageNo) const;
+  const string& getName() const { return fileName; }
+  // the DB header as it is cached now
+  void copyHeader(DBPage& out) const
+    {
+      std::lock_guard<std::mutex> lk(hdrLatch);
+      out = hdr;
+    }
 
   bool operator == (const File & other) const
     {
@@ -40,16 +155,25 @@ class File {
   File(const string &fname);                   // initialize
   ~File();                  // deallocate file object
 
-  static const Status create(const string &fileName);
+  static const Status create(const string &fileName, const int pageSize,
+                             const bool compress);
   static const Status destroy(const string &fileName);
 
-  const Status open();
+  const Status open(const bool direct); // direct asks for O_DIRECT
   const Status close();
 
   const Status intread(const int pageNo,
 		 Page* pagePtr) const;        // internal file read
   const Status intwrite(const int pageNo,
 		  const Page* pagePtr);       // internal file write
+  const Status vectorIO(const bool write, const int pageNo,
+                        Page* const* pagePtrs,
+                        const int count) const; // internal run transfer
+  bool dropDirect() const;            // fall back to buffered I/O
+  int pack(const int pageNo, const Page* pagePtr,
+           char* out) const;          // compress a page for intwrite
+  const Status unpack(const int pageNo,
+                      Page* pagePtr) const; // undo pack after intread
 
 #ifdef DEBUGFREE
   void listFree();                      // list free pages
@@ -58,6 +182,31 @@ class File {
   string fileName;                    // The name of the file
   int openCnt;                        // # times file has been opened
   int unixFile;                       // unix file stream for file
+  int pageSize;                       // size of each page, from DBPage
+  mutable std::atomic<bool> directIO; // opened with O_DIRECT
+  bool compress;                      // DBPage compress, fixed while open
+  int blockSize;                      // file system block size
+  mutable FileStats stats;            // usage since the file was opened
+
+  // the read-only mapping; mapBase and mapPages do not change while
+  // a map is held, so readers need no latch
+  std::mutex mapLatch;                // protects the fields below
+  char* mapBase;                      // start of the mapping, or NULL
+  int mapPages;                       // # pages mapped
+  int mapCnt;                         // # map() not yet unmapped
+
+  // The DB header page lives here while the file is open and goes
+  // back to disk when the file is closed.
+  mutable std::mutex hdrLatch;        // protects the fields below
+  DBPage hdr;                         // cached copy of page 0
+  bool hdrDirty;                      // hdr differs from page 0
+  int extent;                         // # pages the file has room for
+  const Status extend(const int pageNo); // make room for page pageNo
+
+  // the buffer pool frames holding pages of the file, linked through
+  // BufDesc::nextFrame; kept by BufMgr
+  mutable std::mutex frameLatch;      // protects the list
+  int firstFrame;                     // -1 if there are none
 };
 
 class BufMgr;
@@ -103,23 +252,38 @@ class DB {
   DB();                                 // initialize open file table
   ~DB();                                // clean up any remaining open files
 
-  const Status createFile(const string & fileName) ;  // create a new file
+  const Status createFile(const string & fileName,
+                          const int pageSize = PAGESIZE,
+                          const bool compress = false);  // create a new file
   const Status destroyFile(const string & fileName) ; // destroy a file, 
                                                            // release all space
   const Status openFile(const string & fileName, File* & file);  // open a file
   const Status closeFile(File* file);         // close a file
 
+  // open files from now on with O_DIRECT where the file system and
+  // the page size allow it, so pages are cached only in the buffer pool
+  void setDirectIO(const bool on) { directIO = on; }
+
+  // Keep up to files of the files closed last open, pages and header
+  // in memory, for the next openFile of them; the least recently
+  // closed one is really closed when another comes along.  0, the
+  // default, closes every file at its last closeFile, as it also does
+  // to those kept so far.  To be set to 0 before the buffer pool goes.
+  void setFileCache(const int files);
+
  private:
   OpenFileHashTbl   openFiles;    // list of open files
-};
-
+  std::mutex        latch;        // protects the fields below and
+                                  // open counts
+  bool              directIO;     // see setDirectIO
+  std::list<File*>  cached;       // closed, still open: latest first
+  int               cacheSize;    // see setFileCache
+  std::vector<File*> lingering;   // closed with pages still pinned
 
-// structure of DB (header) page
+  const Status shutFile(File* file); // close file for good
+  void trimCache();               // shut what the cache has beyond
+                                  // cacheSize
+};
 
-typedef struct {
-  int nextFree;                         // page # of next page on free list
-  int firstPage;                        // page # of first page in file
-  int numPages;                         // total # of pages in file
-} DBPage;
 
 #endif
@@ -10,6 +10,8 @@ using namespace std;
 
 #include "page.h"
 #include "buf.h"
+#include "predicate.h"
+#include "btree.h"
 
 extern DB db;
 
@@ -18,9 +20,10 @@ extern DB db;
 
 // Some constant definitions
 const unsigned MAXNAMESIZE = 50;
-
-enum Datatype { STRING, INTEGER, FLOAT };    // attribute data types
-enum Operator { LT, LTE, EQ, GTE, GT, NE };  // scan operators
+const int BULKPAGES = 32;   // # pages bulkInsert writes at a time
+const int MORSELPAGES = 16; // # pages in a unit of parallel scan work
+const int MAXZONEATTRS = 4; // # attributes a zone map can summarize
+const int MAXINDEXES = 4;   // # B+-tree indexes a file can have
 
 struct FileHdrPage
 {
@@ -29,6 +32,90 @@ struct FileHdrPage
   int		lastPage;	// pageNo of last data page in file
   int		pageCnt;	// number of pages
   int		recCnt;		// record count
+  int		fsmPage;	// pageNo of first free space map page
+  int		fsmHint;	// where inserts start looking for space
+  int		dirPage;	// pageNo of first page directory page
+  int		paxAttrs;	// # attributes of a PAX file, 0 if slotted
+  int		paxLen[MAXPAXATTRS]; // their widths, see createHeapFile
+  int		zonePage;	// pageNo of first zone map page, -1 if none
+  int		zoneAttrs;	// # attributes the zone map summarizes
+  RangeAttr	zone[MAXZONEATTRS]; // which, see createZoneMap
+  int		indexCnt;	// # indexes on the file
+  char		indexName[MAXINDEXES][MAXNAMESIZE]; // their files
+  int		chainVersion;	// bumped when a data page leaves the chain
+};
+
+
+// A free space map page holds one byte for each of the
+// pageSize - sizeof(int) pages it covers: 0 if the page is not a data
+// page, else 1 + its free bytes in units of pageSize/256 (at most
+// 255).  The k-th FSM page on the chain starting at
+// FileHdrPage::fsmPage covers page numbers k*cover .. (k+1)*cover-1.
+struct FsmPage
+{
+  int		nextFsm;	// pageNo of next FSM page, -1 if none
+  unsigned char	cat[1];		// really pageSize - sizeof(int) entries
+};
+
+
+// A zone map page holds an entry of 1 + 2*FileHdrPage::zoneAttrs ints
+// for each of the pages it covers: 0 if no record has gone on the page
+// since it was added to the file, else 1, followed by the lowest and
+// the highest value of each attribute among those records.  The k-th
+// zone map page on the chain starting at FileHdrPage::zonePage covers
+// page numbers k*cover .. (k+1)*cover-1.  Deleting records leaves the
+// ranges as they were, so an entry may overstate what is on its page
+// but never understates it.
+struct ZonePage
+{
+  int		nextZone;	// pageNo of next zone map page, -1 if none
+  int		entry[1];	// really (pageSize - sizeof(int)) / sizeof(int)
+};
+
+
+// The page directory lists the data pages of the file in the order of
+// their nextPage chain, in pages chained from FileHdrPage::dirPage.
+// Only the last directory page takes new entries; the others can have
+// room left where pages were removed.
+struct DirPage
+{
+  int		nextDir;	// pageNo of next directory page, -1 if none
+  int		count;		// # entries in use
+  int		pageNo[1];	// really (pageSize - 2*sizeof(int)) / sizeof(int)
+};
+
+
+// A record read in place, whose page stays pinned for as long as the
+// RecordRef holds it: handles can be kept past the scan that produced
+// them, or passed on, without copying the record.  Like the PageGuard
+// inside it a RecordRef can be moved but not copied.  Records of PAX
+// pages are not stored whole, so for those the handle keeps a copy.
+class RecordRef
+{
+  friend class HeapFile;
+
+public:
+  RecordRef() { rec.data = NULL; rec.length = 0; rid = NULLRID; }
+
+  const Record& get() const { return rec; }
+  const void* data() const { return rec.data; }
+  const int length() const { return rec.length; }
+  const RID& getRid() const { return rid; }
+  bool isValid() const { return guard.isPinned(); }
+
+  // drop the record and its pin
+  const Status release()
+  {
+    rec.data = NULL;
+    rec.length = 0;
+    return guard.release();
+  }
+
+private:
+  PageGuard	guard;
+  Record	rec;
+  RID		rid;
+  vector<char>	copy;		// the record, if its page is a PAX page
 };
 
 
@@ -43,8 +130,56 @@ protected:
    Page* 	curPage;	// data page currently pinned in buffer pool
    int   	curPageNo;	// page number of pinned page
    bool  	curDirtyFlag;   // true if page has been updated
+   bool		curMapped;	// curPage is in the file's mapping and
+				// not pinned (see HeapFileScan::setMapped)
    RID   	curRec;         // rid of last record returned
 
+   vector<int>	fsmPages;	// the FSM chain, read when needed
+   vector<int>	dirPages;	// the directory chain, likewise
+				// (see readDirChain)
+   vector<int>	zonePages;	// the zone map chain, read when needed
+   vector<char>	fetched;	// copies of the records getRecords read
+   vector<char>	row;		// the last PAX record getRecord read
+   vector<BTreeIndex*> indexes;	// the file's indexes, opened when needed
+   vector<string> indexFiles;	// and the names they were opened by
+
+   // free space map upkeep.  setFreeSpace records the free bytes of
+   // data page pageNo after a change (-1 once it is no data page any
+   // more); findFreePage returns a data page other than curPageNo that
+   // the map says has need bytes free, or -1 if there is none.
+   // readFsmChain brings fsmPages up to date, for map pages added
+   // through other handles
+   const Status readFsmChain();
+   const Status setFreeSpace(const int pageNo, const int freeBytes);
+   const Status findFreePage(const int need, int& pageNo);
+
+   // page directory upkeep: add count pages to the end of the
+   // directory, or take one page out of it.  readDirChain brings
+   // dirPages up to date, for pages added through other handles
+   const Status readDirChain();
+   const Status dirAppend(const int* pageNos, const int count);
+   const Status dirRemove(const int pageNo);
+
+   // zone map upkeep, if the file has one.  zoneAdd widens the ranges
+   // of data page pageNo to take in rec; zoneSet gives the page the
+   // entry at entry, or no records if entry is NULL.  zoneMayMatch is
+   // false if the map shows that no record on the page passes filter.
+   // zoneEntry pins the zone map page zoneNo with pageNo's entry,
+   // adding pages to the map if extend, else setting entry to NULL if
+   // the map does not reach that far
+   const Status zoneAdd(const int pageNo, const Record & rec);
+   const Status zoneSet(const int pageNo, const int* entry);
+   const bool zoneMayMatch(const int pageNo, const ScanFilter& filter);
+   const Status zoneEntry(const int pageNo, const bool extend,
+                          int& zoneNo, int*& entry);
+
+   // index upkeep.  openIndexes opens the indexes the header lists,
+   // if they are not open yet; indexInsert and indexDelete add and
+   // remove the entries of record rec at rid in all of them
+   const Status openIndexes();
+   const Status indexInsert(const Record & rec, const RID & rid);
+   const Status indexDelete(const Record & rec, const RID & rid);
+
 public:
 
   // initialize
@@ -56,8 +191,25 @@ public:
   // return number of records in file
   const int getRecCnt() const;
 
-  // given a RID, read record from file, returning pointer and length
+  // return number of data pages in file
+  const int getPageCnt() const { return headerPage->pageCnt; }
+
+  // given a RID, read record from file, returning pointer and length.
+  // The record is on the handle's pinned page, or, off a PAX page, a
+  // copy the handle keeps; either way it stays valid until the next
+  // call on this handle that reads, changes or moves past a record
   const Status getRecord(const RID &rid, Record & rec);
+
+  // the same, returning a handle that keeps the record's page pinned
+  const Status getRecord(const RID &rid, RecordRef & ref);
+
+  // read the records of the n RIDs in rids into out, in the same
+  // order, pinning each page involved only once.  The records are
+  // copies that stay valid until the next call
+  const Status getRecords(const RID* rids, const int n, Record* out);
+
+  // the data pages of the file in chain order, from the page directory
+  const Status getDataPages(vector<int>& pageNos);
 };
 
 
@@ -76,6 +228,12 @@ public:
                            const char* filter, 
                            const Operator op);
 
+    // scan for records that satisfy all (AND) or any (OR) of the
+    // count conditions in conds
+    const Status startScan(const ScanCond* conds,
+                           const int count,
+                           const BoolOp conn);
+
     const Status endScan(); // terminate the scan
     const Status markScan(); // save current position of scan
     const Status resetScan(); // reset scan to last marked location
@@ -83,21 +241,61 @@ public:
     // return RID of next record that satisfies the scan 
     const Status scanNext(RID& outRid);
 
-    // read current record, returning pointer and length
+    // return up to max of the next records that satisfy the scan, all
+    // from the same page, in outRids and outRecs; count is set to how
+    // many.  The records stay valid until the scan moves past their
+    // page.  getRecord/deleteRecord then refer to the last record
+    // looked at, which need not be the last one returned (on a PAX
+    // page, the last slot looked at, which may be empty).  Filters on
+    // PAX pages only read the columns they test.  Returns FILEEOF,
+    // with count 0, at the end of the file
+    const Status scanNextBatch(RID* outRids, Record* outRecs,
+                               const int max, int& count);
+
+    // read current record, returning pointer and length, valid as
+    // for HeapFile::getRecord
     const Status getRecord(Record & rec);
 
+    // read current record, returning a handle that keeps it pinned
+    const Status getRecord(RecordRef & ref);
+
     // delete current record 
     const Status deleteRecord();
 
-    // marks current page of scan dirty
+    // marks current page of scan dirty.  If the file has a zone map
+    // the current record is taken to have changed and is summarized
+    // again.  The file's indexes are not told: attributes that are
+    // indexed must not be changed in place
     const Status markDirty();
 
+    // # pages the scan has passed over on the strength of the zone map
+    const int getSkippedPages() const { return skippedPages; }
+
+    // read up to pages pages ahead of the scan in the background
+    // (0, the default, turns read-ahead off)
+    const Status setReadAhead(const int pages);
+
+    // With on, the pages the scan moves to from now on that are not in
+    // the buffer pool are read where they lie in a read-only mapping
+    // of the file rather than copied into the pool.  A page that is
+    // brought into the pool and changed while the scan is on it may
+    // not be seen to change.  Records of mapped pages cannot be
+    // deleted (MAPPEDPAGE); pages added to the file after the call
+    // come through the pool.  For scans of read-mostly files.
+    const Status setMapped(const bool on);
+
 private:
-    int   offset;            // byte offset of filter attribute
-    int   length;            // length of filter attribute
-    Datatype type;           // datatype of filter attribute
-    const char* filter;      // comparison value of filter
-    Operator op;             // comparison operator of filter
+    ScanFilter filter;       // conditions records must satisfy
+    bool  mapped;            // see setMapped
+    int   readAhead;         // # of pages to prefetch past curPage
+    vector<int> dirList;     // directory of the file, for read-ahead
+    int   dirIndex;          // index of curPageNo in dirList, or -1
+    int   prefetchedTo;      // index in dirList read ahead to
+    vector<int> selection;   // scratch selection vector for batches
+    vector<char> paxRows;    // the records of a batch off a PAX page
+    vector<int> zoneList;    // directory of the file, for skipping pages
+    int   zoneIndex;         // index in zoneList of the page last skipped to
+    int   skippedPages;      // see getSkippedPages
 
      // The following variables are used to preserve the state
     // of the scan when the method markScan() is invoked.
@@ -105,8 +303,31 @@ private:
     // scan to be rolled back to the following
     int   markedPageNo;	// page number of pinned page
     RID   markedRec;         // rid of last record returned
+    PageGuard markedPage;    // the pin on it
+
+    // the header's chainVersion that dirList and zoneList go by
+    int   chainVersion;
+
+    const bool matchRec(const Record & rec);
+
+    // make page pageNo curPage, from the mapping if the scan is mapped
+    // and the page is in it, or else through the buffer pool; and let
+    // go of curPage, unpinning it unless it is mapped
+    const Status readCurPage(const int pageNo);
+    const Status releaseCurPage();
 
-    const bool matchRec(const Record & rec) const;
+    // start reading ahead of curPage, on arriving at it.  first is
+    // true for the first page of the scan
+    void prefetchNext(const bool first);
+
+    // the page after curPage on the chain, minding pages a vacuum
+    // step has taken off it since the scan last moved on
+    const Status nextChainPage(int& pageNo);
+
+    // the page the scan goes on to when the chain says pageNo comes
+    // next: the first one from pageNo on, in directory order, that the
+    // zone map does not rule out, or -1 if there are none
+    const int nextScanPage(const int pageNo);
 };
 
 
@@ -121,6 +342,106 @@ public:
 
     // insert record into file, returning its RID
     const Status insertRecord(const Record & rec, RID& outRid); 
+
+    // insert count records onto new pages at the end of the file,
+    // returning their RIDs in outRids (if not NULL).  The pages are
+    // filled in memory and written straight to the file, BULKPAGES at
+    // a time, without going through the buffer pool; either all the
+    // records are added or none are
+    const Status bulkInsert(const Record* recs, const int count,
+                            RID* outRids = NULL);
+
+    // keep, from now on, the range of values each of the count
+    // attributes in attrs takes on every data page of the file, so
+    // that scans can pass over the pages none of whose records could
+    // match (see HeapFileScan::getSkippedPages).  The records already
+    // in the file are summarized straight away; a zone map the file
+    // had is dropped, and with count 0 none is kept.  Attributes must
+    // be INTEGER or FLOAT, else BADSCANPARM
+    const Status createZoneMap(const RangeAttr* attrs, const int count);
+
+    // make a B+-tree index, in file indexName, on the attribute of
+    // length bytes at offset, and fill it from the records already in
+    // the file (see BTreeIndex::bulkLoad).  From then on records the
+    // file gains or loses are added to and removed from the index;
+    // read it with an IndexScan.  Records too short to have the
+    // attribute are left out.  INDEXEXISTS if the file has an index
+    // of that name, FILEHDRFULL if it has MAXINDEXES
+    const Status createIndex(const string & indexName, const int offset,
+                             const int length, const Datatype type);
+
+    // drop the index from the file and destroy its file; NOINDEX if
+    // the file has none of that name
+    const Status dropIndex(const string & indexName);
+
+    // Do the next step of vacuuming the file: go over up to maxPages
+    // data pages along the chain, from where the last step stopped.
+    // With merge, the records of a page at most a quarter full move
+    // to the page before it, as many as fit, and get new RIDs there
+    // (the indexes follow).  A data page left without records is taken
+    // off the chain and given back to the file, unless it is the only
+    // one or someone has it pinned; disposed is set to how many were.
+    // Each page is an update of its own, so other handles can read the
+    // file in between steps.  Scans open across a step go on along the
+    // chain as it is now (FileHdrPage::chainVersion tells them it
+    // changed).  Records do not move off or onto a page someone has
+    // pinned, so a scan does not run past them, unless it reads through
+    // the file mapping (see HeapFileScan::setMapped), which pins
+    // nothing; a marked page stays, as a scan keeps it pinned.  FILEEOF
+    // once the step reaches the end of the chain; the next one starts
+    // over at the first page
+    const Status vacuum(const int maxPages, const bool merge,
+                        int& disposed);
+
+private:
+    int vacuumAt;       // the page vacuum goes on after, -1 for the first
+
+    // add a data page at the end of the file and make it curPage
+    const Status appendPage();
+
+    // vacuum data page pageNo, which comes after prevNo (-1 if it is
+    // the first); nextNo is set to the page after it, gone to whether
+    // it was disposed of
+    const Status vacuumPage(const int prevNo, const int pageNo,
+                            const bool merge, int& nextNo, bool& gone);
+};
+
+
+// A scan of the whole file by several threads.  The data pages, as
+// listed by the page directory, are cut into morsels of MORSELPAGES
+// pages.  Each worker starts with an equal share of the morsels and,
+// once it is through them, steals half of what is left of another
+// worker's share.  Workers read their pages asynchronously through the
+// shared buffer manager, filter them with their own copy of the scan
+// conditions, and collect the matches per morsel; the morsels' results
+// are concatenated at the end, so they come out in chain order.
+class ParallelScan : public HeapFile
+{
+public:
+
+    ParallelScan(const string & name, Status & status);
+
+    // set the conditions, as for HeapFileScan::startScan; with none
+    // every record matches
+    const Status startScan(const ScanCond* conds,
+                           const int count,
+                           const BoolOp conn);
+
+    // scan the file with workers threads, returning the RIDs of the
+    // records that satisfy the conditions in outRids
+    const Status scan(const int workers, vector<RID>& outRids);
+
+private:
+    struct Share;                 // the morsels a worker has left
+
+    vector<ScanCond> conds;
+    BoolOp conn;
+
+    void work(const int self, vector<Share>& shares,
+              const vector<int>& pageNos, vector<vector<RID> >& results,
+              Status& status, std::atomic<bool>& failed);
+    const Status scanMorsel(const int* pageNos, const int count,
+                            ScanFilter& filter, vector<RID>& out);
 };
 
 #endif
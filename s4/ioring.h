@@ -0,0 +1,77 @@
+#ifndef IORING_H
+#define IORING_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <atomic>
+
+// A minimal io_uring(7) submission/completion ring, driven through the
+// raw system calls.  Any number of threads may submit; exactly one
+// thread (BufMgr's reaper) waits for completions.  Each operation
+// carries a user pointer that comes back with its result, which is
+// the byte count transferred or -errno.
+//
+// If the kernel has no io_uring (or it is disabled), ok() is false and
+// callers do their I/O synchronously instead.
+class IoRing
+{
+private:
+    int ringFd;                 // -1 if the ring could not be set up
+    unsigned entries;           // size of the submission queue
+
+    // submission queue, shared with the kernel
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    struct io_uring_sqe* sqes;
+
+    // completion queue, shared with the kernel
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+
+    void*  sqMap;               // mmapped rings and their sizes
+    size_t sqMapSize;
+    void*  cqMap;
+    size_t cqMapSize;
+    size_t sqesSize;
+
+    std::mutex subLatch;        // serializes submitters
+
+    // bumped by every submission and read back by wait, so that what a
+    // submitter wrote before submitting is visible to the reaper in
+    // terms of the C++ memory model too (the kernel hand-off is not)
+    std::atomic<unsigned long> submitted;
+
+    // fill in the next sqe and hand it to the kernel
+    bool submit(const int opcode, const int fd, const void* addr,
+                const unsigned len, const off_t offset, void* user);
+
+public:
+    IoRing(const unsigned size);  // size = max # operations in flight
+    ~IoRing();
+
+    bool ok() const { return ringFd >= 0; }
+
+    // queue a read of len bytes at offset into buf
+    bool submitRead(const int fd, void* buf, const unsigned len,
+                    const off_t offset, void* user);
+
+    // queue a write of the count buffers of iov at offset; iov must
+    // stay valid until the completion arrives
+    bool submitWritev(const int fd, const struct iovec* iov,
+                      const int count, const off_t offset, void* user);
+
+    // queue an operation that does nothing but complete
+    bool submitNop(void* user);
+
+    // block until an operation completes and return its user pointer
+    // and result.  Only one thread may call this.
+    bool wait(void*& user, int& result);
+};
+
+#endif
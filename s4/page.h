@@ -11,6 +11,10 @@ struct RID{
 
 const RID NULLRID = {-1,-1};
 
+const int NOSLOT = 1;   // slot indexes are <= 0, so this is never one
+const int PAXPAGE = 2;  // the freeSlot of a PAX page, see Page::initPax
+const int MAXPAXATTRS = 32; // most attributes a PAX page's records have
+
 struct Record
 {
   void* data;
@@ -19,40 +23,121 @@ struct Record
 
 // slot structure
 struct slot_t {
-        short	offset;  
-        short	length;  // equals -1 if slot is not in use
+        int	offset;  
+        int	length;  // negative if slot is not in use
 };
 
-const unsigned PAGESIZE = 1024;
-const unsigned DPFIXED= sizeof(slot_t)+4*sizeof(short)+2*sizeof(int);
-const unsigned PAGEDATASIZE = PAGESIZE-DPFIXED+sizeof(slot_t);
-// size of the data area of a page
+const unsigned PAGESIZE = 1024;       // default page size
+const unsigned MINPAGESIZE = 1024;    // smallest supported page size
+const unsigned MAXPAGESIZE = 65536;   // largest supported page size
+const unsigned DPFIXED = 7*sizeof(int); // size of the data page header
+
+// page sizes are powers of two from MINPAGESIZE to MAXPAGESIZE
+inline bool validPageSize(const unsigned size)
+{
+    return size >= MINPAGESIZE && size <= MAXPAGESIZE &&
+           (size & (size - 1)) == 0;
+}
+
+// largest record that fits on an empty page of the given size
+inline unsigned maxRecordSize(const unsigned size)
+{
+    return size - DPFIXED - sizeof(slot_t);
+}
 
 // Class definition for a minirel data page.   
-// The design assumes that records are kept compacted when
-// deletions are performed. Notice, however, that the slot
-// array cannot be compacted.  Notice, this class does not keep
+// A deleted record only has its slot freed: its bytes stay where they
+// are until an insert needs the room, when the records are compacted
+// in one pass.  Slot numbers (and so RIDs) never change.  The free
+// slots at the end of the slot array are given back as soon as they
+// are free; the others make up runs of consecutive free slots, kept
+// on a list so that inserts take one without searching.  The first
+// slot of a run has minus the run's length as its length, and the
+// list links in its offset; the last, the first's index in its
+// offset.  Every free slot's length is minus some number of free
+// slots that start with it, so going over the records hops over each
+// run at once.  Notice, this class does not keep
 // the records align, relying instead on upper levels to take
 // care of non-aligned attributes
+//
+// A page is pageSize bytes long, pageSize being a property of the file
+// it belongs to.  The fixed header comes first, followed by the data
+// area; the slot array starts at the last slot_t of the page and grows
+// backwards towards the data.  sizeof(Page) is the default PAGESIZE,
+// so a Page object is only big enough for a default sized page: larger
+// pages must live in memory of their own size (e.g. a buffer frame).
+//
+// A page can instead be laid out column by column (PAX), for records
+// that all consist of the same fixed width attributes.  The header is
+// the same, except that freeSlot is PAXPAGE and slotCnt the number of
+// records the page has room for; data[] starts with the attribute
+// widths, then a byte per record slot saying whether it is in use,
+// then each attribute's values for all the slots, one after another.
+// Slot numbers count up from 0.  The methods below work on either
+// kind of page, but the records of a PAX page are not stored whole:
+// getRecord and getRecords put them together in memory of the
+// calling thread, which stays valid until its next call on a PAX
+// page.  HeapFile copies the records it hands out into memory of
+// the file handle.
 
 class Page {
 private:
-    char 	data[PAGESIZE - DPFIXED]; 
-    slot_t 	slot[1]; // first element of slot array - grows backwards!
-    short	slotCnt; // number of slots in use;
-    short	freePtr; // offset of first free byte in data[]
-    short	freeSpace; // number of bytes free in data[]
-    short	dummy;	// for alignment purposes
+    int		slotCnt; // number of slots in use;
+    int		freePtr; // offset of first free byte in data[]
+    int		freeSpace; // number of bytes free in data[], holes included
+    int		freeSlot; // first slot on the free list, NOSLOT if none
+    int		pageSize; // size of the page in bytes
     int		nextPage; // forwards pointer
     int		curPage;  // page number of current pointer
+    char 	data[PAGESIZE - DPFIXED]; // really pageSize - DPFIXED bytes
+
+    // slot array: slot(0) is the last slot_t of the page, and the
+    // slots in use are slot(0) down to slot(slotCnt+1)
+    slot_t*	slotArray() { return (slot_t*) ((char*) this + pageSize) - 1; }
+    const slot_t* slotArray() const
+      { return (const slot_t*) ((const char*) this + pageSize) - 1; }
+
+    // free bytes between the last record and the slot array
+    int contiguousSpace() const
+      { return pageSize - (int) DPFIXED - freePtr +
+               slotCnt * (int) sizeof(slot_t); }
+
+    void compact();  // squeeze out the holes left by deleted records
+    void trimSlots(); // give back the free slots at the end of the array
+
+    // runs of free slots, see the class comment
+    static int runLinks(const int next, const int prev);
+    static int runNext(const int links);
+    static int runPrev(const int links);
+    void setRun(const int first, const int n);
+    int runStart(const int last) const;
+    void linkRun(const int first);
+    void unlinkRun(const int first);
+    int liveFrom(int i) const;
+    int slotAfter(const RID & rid) const;
+
+    // PAX layout: data[] starts with numAttrs, recLen, then attrLen[]
+    // and colOff[] (where each attribute's column starts in data[])
+    int paxAttrs() const { return ((const int*) data)[0]; }
+    int paxLen(const int k) const { return ((const int*) data)[2 + k]; }
+    int paxOff(const int k) const
+      { return ((const int*) data)[2 + paxAttrs() + k]; }
+    int liveOff() const { return (2 + 2 * paxAttrs()) * (int) sizeof(int); }
+    const Status paxInsert(const Record & rec, RID& rid);
 
 public:
-    void init(const int pageNo); // initialize a new page
+    void init(const int pageNo, const unsigned size = PAGESIZE); // initialize a new page
+    // initialize a new PAX page for records of numAttrs attributes,
+    // attrLens[k] bytes each, stored in that order.  INVALIDRECLEN if
+    // not even one such record fits
+    const Status initPax(const int pageNo, const unsigned size,
+                         const int* attrLens, const int numAttrs);
     void dumpPage() const;       // dump contents of a page
 
     const Status getNextPage(int& pageNo) const; // returns value of nextPage
     const Status setNextPage(const int pageNo); // sets value of nextPage to pageNo
-    const short getFreeSpace() const; // returns amount of free space
+    const int getFreeSpace() const; // returns amount of free space
+    const int getPageSize() const { return pageSize; } // size given to init()
 
     // inserts a new record (rec) into the page, returns RID of record 
     const Status insertRecord(const Record & rec, RID& rid);
@@ -70,6 +155,30 @@ public:
 
     // returns reference to record with RID rid
     const Status getRecord(const RID & rid, Record & rec);
+
+    // returns the RIDs of and references to up to max records that
+    // follow curRid on the page (all of them for NULLRID), in the
+    // order nextRecord visits them.  Returns ENDOFPAGE if there are none
+    const Status getRecords(const RID & curRid, RID* rids, Record* recs,
+                            const int max, int& count);
+
+    // PAX pages only: the record length, the number of record slots,
+    // the in-use byte of each slot, and where the values of the
+    // attribute at offset, length bytes wide, are stored slot after
+    // slot (NULL if no attribute is exactly that)
+    bool isPax() const { return freeSlot == PAXPAGE; }
+    int paxRecLen() const { return ((const int*) data)[1]; }
+    int paxSlots() const { return slotCnt; }
+    const unsigned char* paxLive() const
+      { return (const unsigned char*) &data[liveOff()]; }
+    const char* paxColumn(const int offset, const int length) const;
+
+    // copy the record in slot slotNo of a PAX page to out
+    void paxRecord(const int slotNo, char* out) const;
+
+    // the number of records initPax would make room for, 0 if none
+    static int paxCapacity(const unsigned size, const int* attrLens,
+                           const int numAttrs);
 };
 
 #endif
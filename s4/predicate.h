@@ -0,0 +1,140 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <vector>
+#include "page.h"
+
+enum Datatype { STRING, INTEGER, FLOAT };    // attribute data types
+enum Operator { LT, LTE, EQ, GTE, GT, NE };  // scan operators
+
+// Compiled forms of a scan predicate "attribute op filter".  There is
+// one specialization for every (Datatype, Operator) pair, chosen once
+// when the scan starts, so that testing a record involves neither a
+// switch on the type nor one on the operator.
+
+// test one attribute value, length bytes long, against the filter
+typedef bool (*AttrMatch)(const char* attr, const char* filter,
+                          const int length);
+
+// test the attribute at offset in each of the n records, putting the
+// indexes of the ones that match into sel and returning how many there
+// are.  Records too short to hold the attribute do not match.
+typedef int (*BatchMatch)(const Record* recs, const int n,
+                          const int offset, const int length,
+                          const char* filter, int* sel);
+
+// the same over the n values, length bytes each, stored one after
+// another from values on, as in a column of a PAX page
+typedef int (*ColumnMatch)(const char* values, const int n,
+                           const int length, const char* filter, int* sel);
+
+// whether some value between lo and hi, inclusive, could be "value op
+// filter".  lo > hi stands for no values at all
+typedef bool (*RangeMatch)(const char* lo, const char* hi,
+                           const char* filter);
+
+const AttrMatch attrMatcher(const Datatype type, const Operator op);
+
+// NULL for STRING: only numeric attributes have ranges
+const RangeMatch rangeMatcher(const Datatype type, const Operator op);
+
+// these use AVX2 for INTEGER and FLOAT attributes if the CPU has it
+const BatchMatch batchMatcher(const Datatype type, const Operator op);
+const ColumnMatch columnMatcher(const Datatype type, const Operator op);
+
+
+enum BoolOp { AND, OR };    // how the conditions of a filter combine
+
+// an attribute summarized by its range of values, e.g. in a zone map
+struct RangeAttr
+{
+  int		offset;
+  int		length;
+  Datatype	type;
+};
+
+// one condition of a scan filter: the length bytes at offset in the
+// record, of the given type, compared with filter using op
+struct ScanCond
+{
+  int		offset;
+  int		length;
+  Datatype	type;
+  const char*	filter;
+  Operator	op;
+};
+
+// A list of conditions that a record must satisfy all of (AND) or any
+// of (OR).  Conditions are tried in turn and evaluation stops as soon
+// as the outcome is known.  The filter counts how often each condition
+// holds and every REORDEREVERY records puts the ones most likely to
+// decide the outcome first: the most selective for AND, the least
+// selective for OR.  An empty filter matches every record.
+class ScanFilter
+{
+public:
+  static const unsigned long REORDEREVERY = 4096;
+
+  ScanFilter();
+
+  // returns BADSCANPARM if a condition is malformed, leaving the
+  // filter as it was
+  const Status set(const ScanCond* conds, const int count,
+                   const BoolOp conn);
+  void clear();
+  bool empty() const { return terms.empty(); }
+
+  bool match(const Record& rec);
+
+  // the BatchMatch of the whole filter: puts the indexes of the
+  // matching records among recs[0..n-1] into sel, in order, and
+  // returns how many there are
+  int select(const Record* recs, const int n, int* sel);
+
+  // the same for the in-use slots among first .. first+n-1 of a PAX
+  // page, reading only the columns of the attributes the conditions
+  // test; sel gets slot numbers less first.  Returns -1, having done
+  // nothing, if some condition's attribute is not a column of the page
+  int selectColumns(const Page& page, const int first, const int n,
+                    int* sel);
+
+  // whether records whose values of the count attributes in attrs lie
+  // in the ranges at ranges (the lowest value of each attribute, then
+  // its highest, attribute after attribute) could pass.  Conditions on
+  // other attributes could always hold
+  bool mayMatch(const RangeAttr* attrs, const int count,
+                const char* ranges) const;
+
+private:
+  struct Term
+  {
+    ScanCond		cond;
+    AttrMatch		attrMatch;
+    BatchMatch		batchMatch;
+    ColumnMatch		columnMatch;
+    RangeMatch		rangeMatch;
+    unsigned long	tried;     // # records the term was tested on
+    unsigned long	passed;    // # of those it held for
+  };
+
+  std::vector<Term>	terms;
+  BoolOp		conn;
+  unsigned long		untilReorder; // # records before the next reorder
+
+  // scratch space for select
+  std::vector<Record>	subset;
+  std::vector<int>	cand;
+  std::vector<int>	hits;
+  std::vector<int>	picked;
+  std::vector<int>	rows;
+  std::vector<const char*> columns;
+
+  void counted(const int n);     // n more records went through
+
+  // the open records of select and selectColumns go on to the next
+  // term: hits[0..m-1] are the indexes into cand of those it held for
+  void narrow(const int m, int& open, int& npicked);
+  int selected(const int open, const int npicked, int* sel);
+};
+
+#endif
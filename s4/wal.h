@@ -0,0 +1,140 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include "db.h"
+using namespace std;
+
+// A redo log.  Changes to pages are logged as after-images of the
+// whole page, together with the DB header (DBPage) of each file they
+// belong to, in updates: the changes one operation made, which are
+// replayed whole or not at all.  BufMgr writes the updates (see
+// BufMgr::beginUpdate) and makes sure that a page goes back to its
+// file only once the log has the update that last changed it on disk.
+// Replaying a page image is the same whether the file had the change
+// or not, so recovery just writes every complete update, in log order,
+// over the files.
+//
+// Updates go into a buffer; commit waits until the caller's updates
+// are on disk.  The thread that finds no write in progress writes
+// everything buffered so far with one write and one fdatasync, so the
+// commits of all the threads that piled up behind it share it (group
+// commit).
+//
+// The log starts with a LogFileHdr.  A Lsn is the position just past
+// an update, counted in bytes from the log's creation; checkpoints
+// empty the log and move base on.
+
+typedef unsigned long long Lsn;
+
+const unsigned LOGMAGIC = 0x4d524c67;
+
+struct LogFileHdr
+{
+  unsigned	magic;		// LOGMAGIC
+  unsigned	unused;
+  Lsn		base;		// lsn of the first byte after the header
+};
+
+// kinds of log record
+enum LogRecType { LOGPAGE, LOGFILEHDR, LOGDESTROY, LOGEND };
+
+// Each record is a LogRec followed by length bytes: the file's name
+// with its NUL, then for LOGPAGE the page and for LOGFILEHDR the
+// DBPage.  LOGEND has no name and closes an update.
+struct LogRec
+{
+  unsigned	check;		// checksum of the rest of the record
+  int		type;		// a LogRecType
+  int		length;		// # bytes after the LogRec
+  int		pageNo;		// LOGPAGE: which page
+};
+
+// the records of one update, put together before it is appended
+class LogUpdate
+{
+  friend class LogMgr;
+
+public:
+  bool empty() const { return bytes.empty(); }
+  void clear() { bytes.clear(); files.clear(); }
+
+  void addPage(const File* file, const int pageNo, const Page* page);
+  void addFileHeader(const File* file);
+  void addDestroy(const string & fileName);
+
+private:
+  vector<char>	bytes;
+  vector<string> files;		// names of the files it changes
+
+  char* add(const int type, const string & name, const int pageNo,
+            const int length);
+};
+
+class LogMgr
+{
+public:
+  // open logName, creating it if need be.  BADLOGFILE if it holds
+  // updates: those must be recovered first
+  LogMgr(const string & logName, Status & status);
+  ~LogMgr();  // writes out what is buffered
+
+  // Replay the complete updates in logName onto their files, then
+  // empty it; updates is set to how many there were.  To be run
+  // before the files are opened, and without a LogMgr on logName.
+  // OK, with updates 0, if there is no log
+  static const Status recover(const string & logName, int & updates);
+
+  // add update to the log, setting lsn to where it ends
+  const Status append(const LogUpdate & update, Lsn & lsn);
+
+  // wait until the log is on disk up to lsn
+  const Status flush(const Lsn lsn);
+
+  // wait until every update the calling thread appended is on disk.
+  // With a group delay, first wait that many microseconds for other
+  // threads to commit too
+  const Status commit();
+  void setGroupDelay(const int micros) { groupDelay = micros; }
+
+  // Empty the log, once the files it has changed are on disk.  The
+  // caller (BufMgr::checkpoint) has written every dirty page back and
+  // holds updateLatch exclusively
+  const Status truncate();
+
+  const Lsn getEnd();                  // lsn of the end of the log
+  const unsigned long long getCommits() const { return commits; }
+  const unsigned long long getSyncs() const { return syncs; }
+
+  // held shared by every open update, exclusively by checkpoints
+  std::shared_mutex updateLatch;
+
+private:
+  string	logName;
+  int		fd;			// the log file, -1 if not open
+
+  std::mutex	latch;			// protects the fields below
+  std::condition_variable written;	// signalled after each write
+  vector<char>	buf;			// appended, not yet written
+  Lsn		bufStart;		// lsn of buf[0]
+  Lsn		base;			// lsn of the first byte in the file
+  Lsn		durable;		// on disk up to here
+  bool		writing;		// a thread is writing buf out
+  set<string>	changed;		// files changed since the last
+					// truncate
+
+  std::atomic<int> groupDelay;
+  std::atomic<unsigned long long> commits;  // commit calls
+  std::atomic<unsigned long long> syncs;    // fdatasyncs of the log
+
+  LogMgr(const LogMgr&);                    // not copyable
+  LogMgr& operator=(const LogMgr&);
+};
+
+#endif